@@ -11,7 +11,18 @@ You should have received a copy of the GNU Lesser General Public License along w
 import random
 import os
 import re
+import sys
 import time
+import subprocess
+import concurrent.futures
+import threading
+import queue
+import itertools
+import asyncio
+import json
+import atexit
+import zlib
+from array import array
 #import psutil #Not currently active. See bottom of code for how it could be used.
 
 #size, cycles, processes, length, distance
@@ -40,11 +51,32 @@ CYCLES_LIST=[800,8000,8000,80000,80000,80000,100000,500000]
 PROCESSES_LIST=[80,800,8,64,8000,8,8000,10000]
 WARLEN_LIST=[5,20,50,100,100,100,300,200]
 WARDISTANCE_LIST=[5,20,50,100,100,100,300,200]
+READLIMIT_LIST=[80,800,800,8000,8000,8000,8192,55440] #pMARS-style read and write limits. The same as the core size means no limit.
+WRITELIMIT_LIST=[80,800,800,8000,8000,8000,8192,55440] #(the simulator has to be built to enforce them; the evolver folds addresses to fit)
+PSPACE_LIST=[0,0,0,0,0,0,0,0] #size of P-space. 0 leaves it up to the simulator, -1 turns P-space off.
+
+SIMULATOR="nmars.exe" #anything that takes nMars' command line and prints results the same way will do
+#Builds of the simulator for different CPUs, best first, as (CPU feature, program). At startup the first one this CPU has the
+#feature for (and that's there) is used instead of SIMULATOR, so one setup runs well on old and new machines alike.
+#To force one, for testing a build, set the environment variable EVOLVER_SIMULATOR to it.
+#Fields normalized into a core of up to 65535 cells fit in 16 bits, which keeps the simulator and the export compact.
+#For anything bigger, fields need 32 bits. WIDE_SIMULATOR is a build with 32-bit fields, used for those arenas only.
+NARROW_CORESIZE=65535
+WIDE_SIMULATOR="" #e.g. "nmars-wide.exe". "" means SIMULATOR handles big cores too.
+SIMULATOR_BUILDS=[] #e.g. [("avx512f","nmars-avx512.exe"),("avx2","nmars-avx2.exe"),("sse4_2","nmars-sse42.exe")]
 
 NUMWARRIORS=500
 ALREADYSEEDED=True ################# Set to False on first or it will not work.
 
 CLOCK_TIME=24.0 #actual wall clock time in hours you want to take
+CHECKPOINT_INTERVAL=0 #seconds between checkpoints, 0 for none. Lets a run resume with its clock (and era) where it left off. See README.
+CHECKPOINT_COMPACT=24 #after this many checkpoints of just the changes, write one full snapshot and start the log over
+EXPORT_PATH="" #folder to export the population, battle results and family tree to, for analysis (see README). "" for none.
+EXPORT_INTERVAL=3600 #seconds between exports
+EXPORT_COMPRESS=False #zlib each column. Smaller, but then it can't be memory-mapped.
+WRITE_BEHIND=False #if True, arena files are written by a background thread instead of the battle loop (see README)
+WRITE_BEHIND_RATE=500 #most files per second the background thread writes
+WAL_COMMIT_INTERVAL=0 #seconds, 0 for off. If on, every replaced warrior is also logged, and made safe on disk this often. Use with checkpoints.
 FINAL_ERA_ONLY=False #if True, skip the first two eras and go straight to the last one(ie. if you want to continue fine-tuning where you left off)
                      #Or you're doing other research into the parameters and don't want them changing.
 
@@ -63,6 +95,7 @@ MAGIC_NUMBER_LIST=[3,3,2] #This will replace a constant with the magic number (c
 #-plenty of archived warriors to cycle through
 ARCHIVE_LIST=[2000,3000,3000]
 UNARCHIVE_LIST=[3000,2000,1000]
+ARCHIVE_GRID=False #if True, the archive becomes a grid sorted by how warriors behave, with the best warrior in each cell (see README)
 
 
 #******* Not included with distribution. You do not need to use this. ***********
@@ -72,8 +105,18 @@ LIBRARY_PATH="" #instructions to pull from. Maybe a previous evolution run, mayb
 
 CROSSOVERRATE_LIST=[10,2,5] # 1 in this chance of switching to picking lines from other warrior, per instruction
 TRANSPOSITIONRATE_LIST=[10,12,20] # 1 in this chance of swapping location of multiple instructions, per warrior
+VARIABLE_LENGTH=False #if True, warriors can be shorter than WARLEN_LIST, and grow or shrink by inserting or deleting instructions
+INSERTIONRATE_LIST=[8,12,20] # 1 in this chance of inserting a random instruction, per warrior (only if VARIABLE_LENGTH)
+DELETIONRATE_LIST=[8,12,20] # 1 in this chance of deleting an instruction, per warrior (only if VARIABLE_LENGTH)
+LINKEDRATE_LIST=[20,10,6] # 1 in this chance of moving a group of fields that point at the same address all together, per warrior
 
 BATTLEROUNDS_LIST=[1,20,100]
+ROUNDSPLIT_LIST=[1,1,1,1,1,1,1,4] #per arena. More than 1 splits the rounds of a battle between that many nMars running at once.
+BATTLE_TIMEOUT_LIST=[30,60,60,300,300,300,600,3600] #seconds, per arena. A battle still running after this is killed.
+BATTLE_RETRIES=2 #a battle that times out, crashes or prints no scores is tried this many more times, then skipped
+FAILED_BATTLES_LIMIT=20 #the run stops after this many battles in a row have been skipped, something's wrong with the setup
+PIN_WORKERS=False #Linux only. If True, each battle thread (and the nMars it starts) stays on one CPU, see worker_cpus
+HUGE_PAGES=False #Linux only. If True, ask glibc to back the simulator's memory with huge pages (glibc 2.35 or later)
 PREFER_WINNER_LIST=[True, False, False]
 
 #Biasing toward more viable warriors. Most popular instructions more likely.
@@ -100,8 +143,1090 @@ def corenorm(x,y):
     return((y+x))
   return(x)
 
+#What each addressing mode does, looked up instead of tested for case by case: whether the field is an address at all,
+#which field of the instruction it points at holds the real pointer (2 for A, 3 for B, as in a split line, None for
+#direct), and what's added to that pointer before it's used. Post-increments only change it after, so they don't matter
+#to where this use lands.
+MODE_TABLE={
+  '#':(False,None,0),
+  '$':(True,None,0),
+  '*':(True,2,0),
+  '@':(True,3,0),
+  '{':(True,2,-1),
+  '<':(True,3,-1),
+  '}':(True,2,0),
+  '>':(True,3,0)}
+ADDRESS_MODES=frozenset(mode for mode in MODE_TABLE if MODE_TABLE[mode][0])
+
+#With read and write limits, an address further away than half the limit folds back around, the way pMARS does it.
+#Address fields (not immediates) are folded to fit: the B-field to the write limit if the instruction writes there,
+#everything else to the read limit. Whether an arena has limits at all is worked out once, here, so arenas without
+#them skip the folding entirely.
+WRITING_OPCODES=("MOV","ADD","SUB","MUL","DIV","MOD","DJN")
+FOLD_LIMITS=[]
+for arena in range(0,LASTARENA+1):
+  if READLIMIT_LIST[arena]>=CORESIZE_LIST[arena] and WRITELIMIT_LIST[arena]>=CORESIZE_LIST[arena]:
+    FOLD_LIMITS.append(None)
+  else:
+    FOLD_LIMITS.append((READLIMIT_LIST[arena],WRITELIMIT_LIST[arena]))
+
+def fold(x,limit):
+  return corenorm(coremod(x,limit),limit)
+
+#each arena's rules as nMars flags. They never change during a run, so they're put together once, here.
+ARENA_FLAGS=[]
+for arena in range(0,LASTARENA+1):
+  arenaflags=["-s",str(CORESIZE_LIST[arena]),"-c",str(CYCLES_LIST[arena]),"-p",str(PROCESSES_LIST[arena]),"-l",str(WARLEN_LIST[arena]),"-d",str(WARDISTANCE_LIST[arena])]
+  if PSPACE_LIST[arena]>0:
+    arenaflags.extend(["-S",str(PSPACE_LIST[arena])])
+  elif PSPACE_LIST[arena]<0:
+    arenaflags.append("-xp")
+  ARENA_FLAGS.append(arenaflags)
+
+#Every instruction of every offspring gets split apart and sanitized, and winners (and their near-clones) send the same
+#lines through over and over. So the split pattern is compiled once, and the sanitized result of each line is remembered.
+#The result only depends on the line and the arena, so nothing ever has to be invalidated, just cleared if it gets too big.
+SPLIT_RE=re.compile(r'[ \.,\n]')
+SANITIZE_CACHE_MAX=200000
+sanitize_cache={}
+
+def sanitize_line(line,arena):
+  key=(arena,line)
+  cached=sanitize_cache.get(key)
+  if cached is not None:
+    return cached
+  splitline=SPLIT_RE.split(line)
+  num1=corenorm(coremod(int(splitline[2][1:]),SANITIZE_LIST[arena]),CORESIZE_LIST[arena])
+  num2=corenorm(coremod(int(splitline[3][1:]),SANITIZE_LIST[arena]),CORESIZE_LIST[arena])
+  limits=FOLD_LIMITS[arena]
+  if limits is not None:
+    if splitline[2][0:1] in ADDRESS_MODES:
+      num1=fold(num1,limits[0])
+    if splitline[3][0:1] in ADDRESS_MODES:
+      if splitline[0] in WRITING_OPCODES:
+        num2=fold(num2,limits[1])
+      else:
+        num2=fold(num2,limits[0])
+  result=splitline[0]+"."+splitline[1]+" "+splitline[2][0:1]+str(num1)+","+splitline[3][0:1]+str(num2)+"\n"
+  if len(sanitize_cache)>=SANITIZE_CACHE_MAX:
+    sanitize_cache.clear()
+  sanitize_cache[key]=result
+  return result
+
+#The magic number mutation hopes to hit fields that point at the same address. This works out which ones actually do:
+#every A or B field that isn't immediate points at (line+value), and fields with the same target are grouped together.
+def pointer_classes(lines,arena):
+  classes={}
+  for i in range(0,len(lines)):
+    splitline=SPLIT_RE.split(lines[i])
+    for field in (2,3):
+      if splitline[field][0:1] in ADDRESS_MODES:
+        target=(i+int(splitline[field][1:]))%CORESIZE_LIST[arena]
+        classes.setdefault(target,[]).append((i,field))
+  return [members for members in classes.values() if len(members)>1]
+
+#move every field in the group by the same amount, so they all still point at the same (new) address
+def shift_pointers(lines,members,offset):
+  for (i,field) in members:
+    splitline=SPLIT_RE.split(lines[i])
+    splitline[field]=splitline[field][0:1]+str(int(splitline[field][1:])+offset)
+    lines[i]=splitline[0]+"."+splitline[1]+" "+splitline[2]+","+splitline[3]+"\n"
+
+#Putting in or taking out an instruction moves everything after it. Fields that point across that spot are fixed up so
+#they still point at the same instruction they did before. (Immediate fields aren't addresses, so they're left alone.)
+def insert_instruction(lines,k,newline):
+  for j in range(0,len(lines)):
+    splitline=SPLIT_RE.split(lines[j])
+    for field in (2,3):
+      if splitline[field][0:1] in ADDRESS_MODES:
+        target=j+int(splitline[field][1:])
+        newj=j+1 if j>=k else j
+        newtarget=target+1 if target>=k else target
+        splitline[field]=splitline[field][0:1]+str(newtarget-newj)
+    lines[j]=splitline[0]+"."+splitline[1]+" "+splitline[2]+","+splitline[3]+"\n"
+  lines.insert(k,newline)
+
+def delete_instruction(lines,k):
+  for j in range(0,len(lines)):
+    if j==k:
+      continue
+    splitline=SPLIT_RE.split(lines[j])
+    for field in (2,3):
+      if splitline[field][0:1] in ADDRESS_MODES:
+        target=j+int(splitline[field][1:])
+        newj=j-1 if j>k else j
+        newtarget=target-1 if target>k else target #pointing at the deleted line now means pointing at the one after it
+        splitline[field]=splitline[field][0:1]+str(newtarget-newj)
+    lines[j]=splitline[0]+"."+splitline[1]+" "+splitline[2]+","+splitline[3]+"\n"
+  del lines[k]
+
+def random_instruction(arena):
+  #Biasing toward more viable warriors: 3 in 4 chance of choosing an address within the warrior.
+  if random.randint(1,4)==1:
+    num1=random.randint(-CORESIZE_LIST[arena],CORESIZE_LIST[arena])
+  else:
+    num1=random.randint(-WARLEN_LIST[arena],WARLEN_LIST[arena])
+  if random.randint(1,4)==1:
+    num2=random.randint(-CORESIZE_LIST[arena],CORESIZE_LIST[arena])
+  else:
+    num2=random.randint(-WARLEN_LIST[arena],WARLEN_LIST[arena])
+  return random.choice(INSTR_SET)+"."+random.choice(INSTR_MODIF)+" "+random.choice(INSTR_MODES)+str(num1)+","+random.choice(INSTR_MODES)+str(num2)+"\n"
+
+#Where a field of line i first lands, counted from the start of the warrior, or None if it's immediate. Indirect modes
+#follow the pointer when it's inside the warrior (as the warrior starts out), otherwise the pointer's own line is used.
+def field_target(splitlines,i,field):
+  isaddress,through,before=MODE_TABLE.get(splitlines[i][field][0:1],(False,None,0))
+  if not isaddress:
+    return None
+  target=i+int(splitlines[i][field][1:])
+  if through is not None and 0<=target<len(splitlines) and len(splitlines[target])>=4:
+    target=target+int(splitlines[target][through][1:])+before
+  return target
+
+#For the archive grid. Three things about a warrior, each put in one of four bins:
+#how many processes it starts (SPL count), its bombing step (biggest immediate ADD/SUB) and how widely it writes (spread of MOV targets)
+def behaviour_cell(lines,arena):
+  spl=0
+  step=0
+  targets=[]
+  splitlines=[SPLIT_RE.split(line) for line in lines]
+  for i in range(0,len(lines)):
+    splitline=splitlines[i]
+    if len(splitline)<4:
+      continue
+    if splitline[0]=="SPL":
+      spl=spl+1
+    elif splitline[0] in ("ADD","SUB") and splitline[2][0:1] not in ADDRESS_MODES:
+      step=max(step,abs(int(splitline[2][1:])))
+    elif splitline[0]=="MOV" and splitline[3][0:1] in ADDRESS_MODES:
+      targets.append(field_target(splitlines,i,3))
+  if targets:
+    spread=max(targets)-min(targets)
+  else:
+    spread=0
+  def distance_bin(x):
+    if x==0:
+      return 0
+    if x<=WARLEN_LIST[arena]:
+      return 1
+    if x<=CORESIZE_LIST[arena]//8:
+      return 2
+    return 3
+  return (min(spl,3),distance_bin(step),distance_bin(spread))
+
+#a cell is (arena, then the three bins), since the bins only mean something within one arena's sizes
+def grid_name(cell):
+  return "grid-"+"-".join(str(x) for x in cell)
+
+def grid_path(cell):
+  return "archive\\"+grid_name(cell)+".red"
+
+#Warriors that come from the archive, from other evolvers, or that were written by hand. These are the tasks:
+#1. Truncate any too long
+#2. Pad any too short with DATs (unless VARIABLE_LENGTH, then they just stay short)
+#3. Sanitize values
+#4. Try to be tolerant of working with other evolvers that may not space things exactly the same.
+#A line that can't be made sense of raises IndexError or ValueError.
+def clean_line(line,arena):
+  line=line.replace('  ',' ').replace('START','').replace(', ',',').strip()
+  return sanitize_line(line,arena)
+
+def clean_warrior(sourcelines,arena):
+  newlines=[]
+  for line in sourcelines:
+    if line.strip()=="" or line.startswith(";"):
+      continue #comments, like the name of a hand-written warrior
+    if line.strip().upper()=="END":
+      break
+    if len(newlines)>=WARLEN_LIST[arena]:
+      break
+    newlines.append(clean_line(line,arena))
+  while len(newlines)<WARLEN_LIST[arena] and VARIABLE_LENGTH==False:
+    newlines.append('DAT.F $0,$0\n')
+  return newlines
+
+#Winners get read over and over: to breed, to be archived, to have instructions nabbed from them. So each warrior file is
+#read once and kept in memory after that. Writing a warrior goes through here too, so the copy in memory is never stale.
+warrior_cache={}
+
+#Clones and near-clones are everywhere, so identical warriors share one image in memory, and identical lines share one string.
+#Each image counts the slots using it, so it's dropped when the last of them is overwritten.
+warrior_images={} #image -> [image, number of slots using it]
+
+def intern_warrior(lines,terminated=False):
+  #terminated: every line is known to end in a newline already, as in a file in the evolver's own format
+  if terminated==True:
+    image=tuple(map(sys.intern,lines))
+  else:
+    image=tuple(sys.intern(line if line.endswith("\n") else line+"\n") for line in lines)
+  entry=warrior_images.get(image)
+  if entry is None:
+    entry=[image,0]
+    warrior_images[image]=entry
+  entry[1]=entry[1]+1
+  return entry[0]
+
+def release_warrior(image):
+  entry=warrior_images.get(image)
+  if entry is not None:
+    entry[1]=entry[1]-1
+    if entry[1]<=0:
+      del warrior_images[image]
+
+def warrior_path(arena,slot):
+  return "arena"+str(arena)+"\\"+str(slot)+".red"
+
+def read_warrior(arena,slot):
+  key=(arena,int(slot))
+  lines=warrior_cache.get(key)
+  if lines is None:
+    with open(warrior_path(arena,slot),"r") as f:
+      lines=intern_warrior(f.readlines())
+    warrior_cache[key]=lines
+  return lines
+
+#Files are written to a temporary name and renamed over the old one, so anything reading the arena folders (nMars,
+#other tools) sees either the old warrior or the new one, never half of one.
+def save_warrior_file(arena,slot,lines):
+  path=warrior_path(arena,slot)
+  with open(path+".tmp","w") as f:
+    f.writelines(lines)
+  os.replace(path+".tmp",path)
+
+#With WRITE_BEHIND, the battle loop only hands new warriors to a background thread, which writes at most WRITE_BEHIND_RATE
+#files a second. A slot overwritten again before its turn comes is only written once, with the newest warrior.
+#The one time the loop has to wait is when a warrior that hasn't been written yet is about to fight (see flush_warrior).
+unwritten={} #(arena,slot) -> lines, oldest first
+writing=set() #slots being written right now. Only one write of a slot at a time, and it always takes the newest version.
+unwritten_changed=threading.Condition() #guards unwritten and writing, never held while a file is being written
+
+def take_unwritten(key):
+  #with unwritten_changed held: wait out a write of this slot already going, then claim the newest version (or None)
+  while key in writing:
+    unwritten_changed.wait()
+  lines=unwritten.pop(key,None)
+  if lines is not None:
+    writing.add(key)
+  return lines
+
+def write_out(key,lines):
+  try:
+    save_warrior_file(key[0],key[1],lines)
+  finally:
+    with unwritten_changed:
+      writing.discard(key)
+      unwritten_changed.notify_all()
+
+def flush_warrior(arena,slot):
+  key=(arena,int(slot))
+  with unwritten_changed:
+    lines=take_unwritten(key)
+  if lines is not None:
+    write_out(key,lines)
+
+def next_unwritten(block):
+  #with unwritten_changed held: claim the oldest slot nobody is writing. If block, wait for one, otherwise give up.
+  while True:
+    for key in unwritten:
+      if key not in writing:
+        return key,take_unwritten(key)
+    if not block and not writing:
+      return None,None
+    unwritten_changed.wait()
+
+def flush_all_warriors():
+  while True:
+    with unwritten_changed:
+      key,lines=next_unwritten(False)
+    if key is None:
+      return
+    write_out(key,lines)
+
+def warrior_writer():
+  while True:
+    with unwritten_changed:
+      key,lines=next_unwritten(True)
+    write_out(key,lines)
+    time.sleep(1.0/WRITE_BEHIND_RATE)
+
+if WRITE_BEHIND==True:
+  threading.Thread(target=warrior_writer,daemon=True).start()
+  atexit.register(flush_all_warriors)
+
+def write_warrior(arena,slot,lines):
+  key=(arena,int(slot))
+  lines=intern_warrior(lines)
+  if WRITE_BEHIND==True:
+    with unwritten_changed:
+      if key in unwritten:
+        count("file writes saved")
+      unwritten[key]=lines
+      unwritten_changed.notify_all()
+  else:
+    save_warrior_file(arena,slot,lines)
+  old=warrior_cache.get(key)
+  warrior_cache[key]=lines
+  dirty_slots.add(key)
+  if WAL_COMMIT_INTERVAL>0:
+    wal_append(key,lines)
+  if old is not None:
+    release_warrior(old)
+
+#Checkpoints. The first one is a full snapshot of every warrior plus the run's clock and metrics. After that, only slots
+#changed since the previous checkpoint are appended to a log, so a checkpoint costs about as much as the evolution since
+#the last one, not the whole population. Every CHECKPOINT_COMPACT checkpoints, it starts over with a new snapshot.
+#Each checkpoint is numbered, so log entries from before the latest snapshot are never replayed on top of it.
+CHECKPOINT_SNAPSHOT="checkpoint.snap"
+CHECKPOINT_LOG="checkpoint.log"
+CHECKPOINT_WAL="population.wal"
+dirty_slots=set()
+checkpoint_number=0
+checkpoints_since_snapshot=0
+
+def checkpoint(elapsed_hours):
+  global checkpoint_number,checkpoints_since_snapshot
+  #a run that didn't resume from a checkpoint always starts with a snapshot of its own, whatever files are lying around
+  fresh=checkpoint_number==0
+  checkpoint_number=checkpoint_number+1
+  with metrics_lock:
+    saved_metrics=dict(metrics)
+  meta=json.dumps({"type":"meta","seq":checkpoint_number,"elapsed":elapsed_hours,"metrics":saved_metrics})+"\n"
+  if fresh or checkpoints_since_snapshot>=CHECKPOINT_COMPACT or not os.path.exists(CHECKPOINT_SNAPSHOT):
+    with open(CHECKPOINT_SNAPSHOT+".tmp","w") as f:
+      for (arena,slot) in sorted(warrior_cache):
+        f.write(json.dumps({"type":"slot","seq":checkpoint_number,"arena":arena,"slot":slot,"lines":warrior_cache[(arena,slot)]})+"\n")
+      f.write(meta)
+      f.flush()
+      os.fsync(f.fileno())
+    os.replace(CHECKPOINT_SNAPSHOT+".tmp",CHECKPOINT_SNAPSHOT)
+    open(CHECKPOINT_LOG,"w").close()
+    checkpoints_since_snapshot=0
+  else:
+    with open(CHECKPOINT_LOG,"a") as f:
+      for (arena,slot) in sorted(dirty_slots):
+        f.write(json.dumps({"type":"slot","seq":checkpoint_number,"arena":arena,"slot":slot,"lines":warrior_cache[(arena,slot)]})+"\n")
+      f.write(meta)
+      f.flush()
+      os.fsync(f.fileno())
+    checkpoints_since_snapshot=checkpoints_since_snapshot+1
+  dirty_slots.clear()
+  if WAL_COMMIT_INTERVAL>0:
+    with wal_lock:
+      del wal_pending[:] #these are in the checkpoint too
+    with wal_file_lock:
+      open(CHECKPOINT_WAL,"w").close() #everything in it is in the checkpoint now
+
+#Write-ahead log. Between checkpoints, every warrior that replaces another (bred or unarchived) is appended here, tagged
+#with the last checkpoint's number. Records wait in memory, and a background thread writes and fsyncs them together every
+#WAL_COMMIT_INTERVAL seconds, so durability costs one fsync per interval instead of one per offspring.
+wal_pending=[]
+wal_lock=threading.Lock() #guards wal_pending
+wal_file_lock=threading.Lock() #guards the file
+
+def wal_append(key,lines):
+  record=json.dumps({"type":"slot","seq":checkpoint_number,"arena":key[0],"slot":key[1],"lines":lines})+"\n"
+  with wal_lock:
+    wal_pending.append(record)
+
+def wal_commit():
+  with wal_lock:
+    records=list(wal_pending)
+    del wal_pending[:]
+  if records:
+    with wal_file_lock:
+      with open(CHECKPOINT_WAL,"a") as f:
+        f.writelines(records)
+        f.flush()
+        os.fsync(f.fileno())
+
+def wal_committer():
+  while True:
+    time.sleep(WAL_COMMIT_INTERVAL)
+    wal_commit()
+
+#only a checkpoint empties the log, so without checkpoints it would grow for the whole run and be replayed in full on restart
+WAL_CHECKPOINT_INTERVAL=3600
+if WAL_COMMIT_INTERVAL>0 and CHECKPOINT_INTERVAL<=0:
+  print("WAL_COMMIT_INTERVAL needs checkpoints, setting CHECKPOINT_INTERVAL to "+str(WAL_CHECKPOINT_INTERVAL))
+  CHECKPOINT_INTERVAL=WAL_CHECKPOINT_INTERVAL
+
+if WAL_COMMIT_INTERVAL>0:
+  threading.Thread(target=wal_committer,daemon=True).start()
+  atexit.register(wal_commit)
+
+def read_checkpoint_file(path,after,population,meta):
+  #slots only count once the meta line that closes their checkpoint has been read, so a half written one is ignored
+  pending={}
+  if not os.path.exists(path):
+    return meta
+  with open(path,"r") as f:
+    for line in f:
+      try:
+        record=json.loads(line)
+      except ValueError:
+        break
+      if record["seq"]<=after:
+        continue
+      if record["type"]=="slot":
+        pending[(record["arena"],record["slot"])]=record["lines"]
+      else:
+        population.update(pending)
+        pending={}
+        meta=record
+  return meta
+
+def restore_checkpoint():
+  #returns the population (arena,slot) -> lines and the meta of the last complete checkpoint, or None if there isn't one
+  global checkpoint_number
+  population={}
+  meta=read_checkpoint_file(CHECKPOINT_SNAPSHOT,0,population,None)
+  if meta is not None:
+    meta=read_checkpoint_file(CHECKPOINT_LOG,meta["seq"],population,meta)
+    checkpoint_number=meta["seq"]
+  if os.path.exists(CHECKPOINT_WAL):
+    #then whatever was replaced after that checkpoint. Each record stands alone, so only a torn last line is lost.
+    with open(CHECKPOINT_WAL,"r") as f:
+      for line in f:
+        try:
+          record=json.loads(line)
+        except ValueError:
+          break
+        if record["seq"]>=checkpoint_number:
+          population[(record["arena"],record["slot"])]=record["lines"]
+  return population,meta
+
+#Columnar export. Every EXPORT_INTERVAL, a numbered set of folders is written to EXPORT_PATH: population-N (every
+#instruction of every warrior), results-N (every battle since the last export) and lineage-N (where every new warrior
+#came from). Each column is its own file of raw numbers (numpy.fromfile or numpy.memmap reads them as they are),
+#with a manifest.json giving the number of rows, the type of each column, and what the opcode/modifier/mode numbers mean.
+COLUMN_TYPES={'B':'uint8','h':'int16','i':'int32','d':'float64'}
+results_columns={"arena":array('B'),"era":array('B'),"slot1":array('i'),"slot2":array('i'),"score1":array('i'),"score2":array('i'),"time":array('d')}
+lineage_columns={"arena":array('B'),"era":array('B'),"child":array('i'),"parent1":array('i'),"parent2":array('i'),"kind":array('B'),"time":array('d')}
+LINEAGE_KINDS=["bred","unarchived"] #for unarchived warriors, the parents are 0
+opcode_numbers={}
+export_number=0
+if EXPORT_PATH!="" and os.path.isdir(EXPORT_PATH):
+  for name in os.listdir(EXPORT_PATH):
+    if re.match(r'population-\d+$',name):
+      export_number=max(export_number,int(name.split("-")[1]))
+
+def record_result(arena,era,cont1,cont2,score1,score2):
+  if EXPORT_PATH!="":
+    for name,value in (("arena",arena),("era",era),("slot1",cont1),("slot2",cont2),("score1",score1),("score2",score2),("time",time.time())):
+      results_columns[name].append(value)
+
+def record_lineage(arena,era,child,parent1,parent2,kind):
+  if EXPORT_PATH!="":
+    for name,value in (("arena",arena),("era",era),("child",child),("parent1",parent1),("parent2",parent2),("kind",kind),("time",time.time())):
+      lineage_columns[name].append(value)
+
+def write_columns(folder,columns,extra):
+  os.makedirs(folder)
+  manifest={"rows":len(next(iter(columns.values()))),"byteorder":sys.byteorder,"compressed":EXPORT_COMPRESS,"columns":{}}
+  for name,column in columns.items():
+    data=column.tobytes()
+    if EXPORT_COMPRESS==True:
+      data=zlib.compress(data)
+    with open(os.path.join(folder,name+".bin"),"wb") as f:
+      f.write(data)
+    manifest["columns"][name]=COLUMN_TYPES[column.typecode]
+  manifest.update(extra)
+  with open(os.path.join(folder,"manifest.json"),"w") as f:
+    json.dump(manifest,f,indent=1)
+
+def export_columns():
+  global export_number
+  export_number=export_number+1
+  if max(CORESIZE_LIST)>NARROW_CORESIZE:
+    fieldtype='i'
+  else:
+    fieldtype='h'
+  population={"arena":array('B'),"slot":array('i'),"line":array('i'),"opcode":array('B'),"modifier":array('B'),"amode":array('B'),"anum":array(fieldtype),"bmode":array('B'),"bnum":array(fieldtype)}
+  for (arena,slot) in sorted(warrior_cache):
+    lines=warrior_cache[(arena,slot)]
+    for i in range(0,len(lines)):
+      splitline=SPLIT_RE.split(lines[i])
+      try:
+        codes=(INSTR_MODIF.index(splitline[1]),INSTR_MODES.index(splitline[2][0:1]),int(splitline[2][1:]),INSTR_MODES.index(splitline[3][0:1]),int(splitline[3][1:]))
+      except (IndexError,ValueError):
+        continue #not something we wrote (a library line, say), so it's left out
+      population["arena"].append(arena)
+      population["slot"].append(slot)
+      population["line"].append(i)
+      population["opcode"].append(opcode_numbers.setdefault(splitline[0],len(opcode_numbers)))
+      population["modifier"].append(codes[0])
+      population["amode"].append(codes[1])
+      population["anum"].append(codes[2])
+      population["bmode"].append(codes[3])
+      population["bnum"].append(codes[4])
+  opcodes=sorted(opcode_numbers,key=lambda opcode:opcode_numbers[opcode])
+  write_columns(os.path.join(EXPORT_PATH,"population-"+str(export_number)),population,{"opcodes":opcodes,"modifiers":INSTR_MODIF,"modes":INSTR_MODES})
+  write_columns(os.path.join(EXPORT_PATH,"results-"+str(export_number)),results_columns,{})
+  write_columns(os.path.join(EXPORT_PATH,"lineage-"+str(export_number)),lineage_columns,{"kinds":LINEAGE_KINDS})
+  for column in list(results_columns.values())+list(lineage_columns.values()):
+    del column[:]
+  print("Exported to "+EXPORT_PATH+" (set "+str(export_number)+")")
+
+#counts of things worth knowing about in a long run, like battles that had to be retried or thrown away
+metrics={}
+metrics_lock=threading.Lock()
+
+def count(name,amount=1):
+  with metrics_lock:
+    metrics[name]=metrics.get(name,0)+amount
+
+def cpu_features():
+  #the names Linux uses in /proc/cpuinfo. On Windows, the few we might need are asked for by number.
+  features=set()
+  if os.path.exists("/proc/cpuinfo"):
+    with open("/proc/cpuinfo","r") as f:
+      for line in f:
+        if line.startswith("flags"):
+          features.update(line.split(":",1)[1].split())
+          break
+  elif os.name=="nt":
+    import ctypes
+    for name,number in (("sse4_2",38),("avx2",40),("avx512f",41)):
+      if ctypes.windll.kernel32.IsProcessorFeaturePresent(number):
+        features.add(name)
+  return features
+
+if os.environ.get("EVOLVER_SIMULATOR"):
+  SIMULATOR=os.environ["EVOLVER_SIMULATOR"]
+  print("Simulator: "+SIMULATOR+" (from EVOLVER_SIMULATOR)")
+elif SIMULATOR_BUILDS:
+  features=cpu_features()
+  for feature,program in SIMULATOR_BUILDS:
+    if feature in features and os.path.exists(program):
+      SIMULATOR=program
+      break
+  print("Simulator: "+SIMULATOR)
+
+simulator_env=None #same environment as ours
+if HUGE_PAGES==True:
+  simulator_env=dict(os.environ,GLIBC_TUNABLES="glibc.malloc.hugetlb=1")
+
+def simulator_for(coresize):
+  if coresize>NARROW_CORESIZE and WIDE_SIMULATOR!="":
+    return WIDE_SIMULATOR
+  return SIMULATOR
+
+def score_line(line):
+  #nMars prints "name by author scores N", and both the name and the author can have spaces in them
+  if " by " not in line:
+    return None
+  words=line.split()
+  try:
+    return (line.split(" by ",1)[0].strip(),int(words[words.index("scores")+1]))
+  except (IndexError,ValueError):
+    return None
+
+def run_files(arena,file1,file2,name1,name2,rounds,show=True,flags=None,extra=None,program=None):
+  '''
+nMars reference
+Rules:
+  -r #      Rounds to play [1]
+  -s #      Size of core [8000]
+  -c #      Cycle until tie [80000]
+  -p #      Max. processes [8000]
+  -l #      Max. warrior length [100]
+  -d #      Min. warriors distance
+  -S #      Size of P-space [500]
+  -f #      Fixed position series
+  -xp       Disable P-space
+  '''
+  #the rules come from the arena's lists, unless flags (nMars style) are given, then those are passed on as they are
+  if flags is None:
+    simulator=simulator_for(CORESIZE_LIST[arena]) if program is None else program #program: a build to compare (see --bench)
+    cmdline=[simulator,file1,file2]+ARENA_FLAGS[arena]+["-r",str(rounds)]
+    if extra is not None:
+      cmdline.extend(extra)
+    timeout=BATTLE_TIMEOUT_LIST[arena]
+  else:
+    coresize=int(flags[flags.index("-s")+1]) if "-s" in flags[:-1] else 8000 #nMars' default
+    cmdline=[simulator_for(coresize),file1,file2]+flags
+    timeout=max(BATTLE_TIMEOUT_LIST)
+  if show:
+    print(" ".join(cmdline))
+  #Every battle is its own nMars process, so a crash or a hang only costs that one battle. Returns None if it never worked.
+  #Not being able to start nMars at all (wrong path, not executable) won't fix itself, so that's raised right away.
+  for attempt in range(0,BATTLE_RETRIES+1):
+    if attempt>0:
+      count("battle retries")
+    try:
+      output=subprocess.run(cmdline,stdout=subprocess.PIPE,universal_newlines=True,timeout=timeout,env=simulator_env).stdout
+    except subprocess.TimeoutExpired:
+      count("battle timeouts")
+      print("Battle timed out: "+" ".join(cmdline))
+      continue
+    except OSError as e:
+      print("Couldn't run nMars: "+str(e))
+      raise
+    results={} #warrior name -> score
+    #note nMars will sort by score regardless of the order in the command-line, so match up score with warrior
+    for line in output.splitlines():
+      if "scores" in line:
+        if show:
+          print(line.strip())
+        score=score_line(line)
+        if score is not None:
+          results[score[0]]=score[1]
+    if (name1 in results or name1 is None) and (name2 in results or name2 is None) and len(results)>=2:
+      return results
+    print("No scores from: "+" ".join(cmdline))
+  count("failed battles")
+  return None
+
+def run_battle(arena,cont1,cont2,rounds,show=True):
+  #warriors in the arenas have no names, so nMars calls them by their file name, which is their slot number
+  if WRITE_BEHIND==True:
+    flush_warrior(arena,cont1)
+    flush_warrior(arena,cont2)
+  split=min(ROUNDSPLIT_LIST[arena],rounds)
+  if split<=1:
+    results=run_files(arena,warrior_path(arena,cont1),warrior_path(arena,cont2),str(cont1),str(cont2),rounds,show)
+    if results is None:
+      return None
+  else:
+    #A long battle in a big arena is split into chunks of rounds, each played by its own nMars at the same time, starting
+    #from its own position series. The chunks' scores are added up in order, so finishing order makes no difference.
+    #Each nMars starts with empty P-space, so a warrior that learns across rounds through P-space (LDP/STP) scores
+    #differently when split. Evolved warriors can't (they never get those instructions), but imported ones might.
+    seed=random.randint(1,1000000)
+    chunks=[rounds//split+(1 if k<rounds%split else 0) for k in range(0,split)]
+    parts=[round_pool.submit(run_files,arena,warrior_path(arena,cont1),warrior_path(arena,cont2),str(cont1),str(cont2),chunks[k],show,flags=None,extra=["-f",str(seed+k)]) for k in range(0,split)]
+    results={str(cont1):0,str(cont2):0}
+    for part in parts:
+      partresults=part.result()
+      if partresults is None:
+        return None
+      for name in results:
+        results[name]=results[name]+partresults[name]
+    if show:
+      print(str(cont1)+" scores "+str(results[str(cont1)])+", "+str(cont2)+" scores "+str(results[str(cont2)])+" (over "+str(split)+" nMars)")
+  return {int(cont1):results[str(cont1)],int(cont2):results[str(cont2)]}
+
+#All battles go through a job queue worked by BATTLE_THREADS threads, each waiting on its own nMars. Submitting a job
+#gives back a future right away (asyncio code can await it through battle_async). Lower priority numbers go first, so
+#something interactive, like ranking a warrior that was just dropped in, jumps ahead of the background evolution.
+#Completion callbacks run on their own thread, so a slow callback never holds up a battle.
+BATTLE_THREADS=os.cpu_count() or 1
+MATRIX_TILE=16 #pairings per job when a batch is split up
+PRIORITY_INTERACTIVE=0
+PRIORITY_BACKGROUND=1
+job_queue=queue.PriorityQueue()
+job_order=itertools.count() #first in, first out within a priority
+callback_queue=queue.Queue()
+
+#On machines with more than one socket (NUMA node), a CPU reaches memory on its own node fastest. Battle threads are
+#handed CPUs node by node, and the nMars each one starts inherits its CPU. Memory gets allocated on the node of the CPU
+#that first touches it, so each battle's core and process queues end up on the same node as the CPU running it.
+def worker_cpus():
+  allowed=os.sched_getaffinity(0)
+  ordered=[]
+  nodes=[name for name in os.listdir("/sys/devices/system/node") if re.match(r'node\d+$',name)] if os.path.isdir("/sys/devices/system/node") else []
+  for node in sorted(nodes,key=lambda name:int(name[4:])):
+    with open("/sys/devices/system/node/"+node+"/cpulist","r") as f:
+      for part in f.read().strip().split(","):
+        if part=="":
+          continue
+        bounds=part.split("-")
+        for cpu in range(int(bounds[0]),int(bounds[-1])+1):
+          if cpu in allowed and cpu not in ordered:
+            ordered.append(cpu)
+  ordered.extend(sorted(cpu for cpu in allowed if cpu not in ordered))
+  return ordered
+
+def pin_thread(number):
+  if PIN_WORKERS==True and hasattr(os,"sched_setaffinity"):
+    cpus=worker_cpus()
+    os.sched_setaffinity(0,{cpus[number%len(cpus)]}) #0 is this thread
+
+def battle_worker(number):
+  pin_thread(number)
+  while True:
+    priority,order,future,fn,args=job_queue.get()
+    if future.set_running_or_notify_cancel():
+      try:
+        future.set_result(fn(*args))
+      except BaseException as e:
+        future.set_exception(e)
+
+def callback_worker():
+  while True:
+    callback,future=callback_queue.get()
+    try:
+      callback(future)
+    except Exception as e:
+      print("Battle callback failed: "+repr(e))
+
+def submit_job(priority,fn,*args,callback=None):
+  future=concurrent.futures.Future()
+  if callback is not None:
+    future.add_done_callback(lambda done:callback_queue.put((callback,done)))
+  job_queue.put((priority,next(job_order),future,fn,args))
+  return future
+
+def submit_battle(arena,cont1,cont2,rounds,priority=PRIORITY_BACKGROUND,callback=None):
+  return submit_job(priority,run_battle,arena,cont1,cont2,rounds,False,callback=callback)
+
+def submit_tiles(count,play,priority,callback):
+  #the whole batch gets one future, which resolves to play(k) for every k, in order. Tiles of MATRIX_TILE go out as jobs.
+  batch=concurrent.futures.Future()
+  if callback is not None:
+    batch.add_done_callback(lambda done:callback_queue.put((callback,done)))
+  batch.set_running_or_notify_cancel()
+  scores=[None]*count
+  if count==0:
+    batch.set_result(scores)
+    return batch
+  remaining=[(count+MATRIX_TILE-1)//MATRIX_TILE]
+  lock=threading.Lock()
+  def run_tile(start,end):
+    for k in range(start,end):
+      scores[k]=play(k)
+  def tile_done(tile):
+    with lock:
+      if batch.done():
+        return
+      if tile.exception() is not None:
+        batch.set_exception(tile.exception())
+        return
+      remaining[0]=remaining[0]-1
+      if remaining[0]==0:
+        batch.set_result(scores)
+  for start in range(0,count,MATRIX_TILE):
+    submit_job(priority,run_tile,start,min(start+MATRIX_TILE,count)).add_done_callback(tile_done)
+  return batch
+
+def submit_pairs(arena,pairs,rounds,priority=PRIORITY_BACKGROUND,callback=None):
+  #pairs of slots. Each resolves to (score of first, score of second), or None if the battle failed.
+  def play(k):
+    results=run_battle(arena,pairs[k][0],pairs[k][1],rounds,False)
+    if results is None:
+      return None
+    return (results[int(pairs[k][0])],results[int(pairs[k][1])])
+  return submit_tiles(len(pairs),play,priority,callback)
+
+def submit_file_pairs(arena,pairs,rounds,priority=PRIORITY_BACKGROUND,callback=None):
+  #The same for warrior files outside the arenas: pairs of (file1,name1,file2,name2), where a name is what nMars will call
+  #that warrior. name2 can be None if it isn't known, it's then whichever name isn't name1.
+  def play(k):
+    file1,name1,file2,name2=pairs[k]
+    results=run_files(arena,file1,file2,name1,name2,rounds,False)
+    if results is None:
+      return None
+    others=[name for name in results if name!=name1]
+    return (results[name1],results[name2] if name2 is not None else results[others[0]])
+  return submit_tiles(len(pairs),play,priority,callback)
+
+def battle_pairs(arena,pairs,rounds,priority=PRIORITY_BACKGROUND):
+  return submit_pairs(arena,pairs,rounds,priority).result()
+
+def battle_file_pairs(arena,pairs,rounds,priority=PRIORITY_BACKGROUND):
+  return submit_file_pairs(arena,pairs,rounds,priority).result()
+
+async def battle_async(arena,cont1,cont2,rounds,priority=PRIORITY_INTERACTIVE):
+  return await asyncio.wrap_future(submit_battle(arena,cont1,cont2,rounds,priority))
+
+for i in range(BATTLE_THREADS):
+  threading.Thread(target=battle_worker,args=(i,),daemon=True).start()
+#The chunks of a split battle (see run_battle) run on a pool of their own, so a battle worker waiting on its chunks never
+#holds up the chunks. Its threads are pinned the same way, each to its own CPU in node order.
+round_thread_numbers=itertools.count()
+round_pool=concurrent.futures.ThreadPoolExecutor(max_workers=BATTLE_THREADS,initializer=lambda:pin_thread(next(round_thread_numbers)))
+threading.Thread(target=callback_worker,daemon=True).start()
+
+def battle_matrix(arena,slots_a,slots_b,rounds,priority=PRIORITY_BACKGROUND):
+  #pairings are listed square by square, so a tile only touches a handful of warriors
+  side=max(1,int(MATRIX_TILE**0.5))
+  pairs=[]
+  where=[]
+  for i0 in range(0,len(slots_a),side):
+    for j0 in range(0,len(slots_b),side):
+      for i in range(i0,min(i0+side,len(slots_a))):
+        for j in range(j0,min(j0+side,len(slots_b))):
+          if slots_a[i]!=slots_b[j]: #no self fights
+            pairs.append((slots_a[i],slots_b[j]))
+            where.append((i,j))
+  matrix=[[None]*len(slots_b) for i in range(len(slots_a))]
+  for (i,j),score in zip(where,battle_pairs(arena,pairs,rounds,priority)):
+    matrix[i][j]=score
+  return matrix
+
+library_lines=[]
+if LIBRARY_PATH!="":
+  with open(LIBRARY_PATH,"r") as f:
+    library_lines=f.readlines() #read once, not once per instruction
+
+#python evolverstage.py --bench
+#Instead of evolving, measure how a decoded population is best held in memory, for every arena's size. Either one tuple per
+#instruction, warrior after warrior (array of structs, like the evolver's own store), or one array per field across the whole
+#population (struct of arrays, like the export). Scanning one field of everyone favours the second, grabbing or changing a
+#whole warrior favours the first. Times are in milliseconds, the best of BENCH_REPEATS.
+BENCH_REPEATS=3
+BENCH_OPERATIONS=20000
+
+def decode_instruction(line):
+  splitline=SPLIT_RE.split(line)
+  return (splitline[0],splitline[1],splitline[2][0:1],int(splitline[2][1:]),splitline[3][0:1],int(splitline[3][1:]))
+
+def best_time(fn):
+  best=None
+  for repeat in range(0,BENCH_REPEATS):
+    start=time.perf_counter()
+    fn()
+    elapsed=(time.perf_counter()-start)*1000
+    if best is None or elapsed<best:
+      best=elapsed
+  return best
+
+def bench_layouts(arena):
+  length=WARLEN_LIST[arena]
+  aos=[[decode_instruction(sanitize_line(random_instruction(arena),arena)) for j in range(0,length)] for i in range(0,NUMWARRIORS)]
+  soa={"opcode":[],"modifier":[],"amode":[],"anum":array('i'),"bmode":[],"bnum":array('i')}
+  for warrior in aos:
+    for instruction in warrior:
+      for name,value in zip(("opcode","modifier","amode","anum","bmode","bnum"),instruction):
+        soa[name].append(value)
+  picks=[(random.randrange(NUMWARRIORS),random.randrange(length)) for i in range(0,BENCH_OPERATIONS)]
+  def scan_aos():
+    return sum(instruction[3] for warrior in aos for instruction in warrior if instruction[0]=="MOV")
+  def scan_soa():
+    return sum(anum for opcode,anum in zip(soa["opcode"],soa["anum"]) if opcode=="MOV")
+  def fetch_aos():
+    for w,i in picks:
+      list(aos[w])
+  def fetch_soa():
+    for w,i in picks:
+      start=w*length
+      list(zip(*(soa[name][start:start+length] for name in ("opcode","modifier","amode","anum","bmode","bnum"))))
+  def change_aos():
+    for w,i in picks:
+      instruction=aos[w][i]
+      aos[w][i]=instruction[0:3]+(instruction[3]+1,)+instruction[4:6]
+  def change_soa():
+    anum=soa["anum"]
+    for w,i in picks:
+      anum[w*length+i]=anum[w*length+i]+1
+  return [(name,best_time(fn_aos),best_time(fn_soa)) for name,fn_aos,fn_soa in (("scan",scan_aos,scan_soa),("fetch",fetch_aos,fetch_soa),("change",change_aos,change_soa))]
+
+#python evolverstage.py --training folder
+#Write a fixed set of battles that look like the evolver's own, to train a profile-guided (PGO, BOLT) build of the simulator
+#on. For every arena: the example warriors, cleaned up to fit, and TRAINING_WARRIORS random ones like a fresh seeding, plus a
+#pairings file for --batch. The same TRAINING_SEED always gives the same workload. Run the printed commands with
+#EVOLVER_SIMULATOR set to the instrumented build to collect the profile.
+TRAINING_SEED=1
+TRAINING_WARRIORS=20
+TRAINING_PAIRINGS=100
+
+def write_training(folder):
+  random.seed(TRAINING_SEED)
+  examples=[]
+  for name in sorted(os.listdir("examples")):
+    if name.endswith(".red"):
+      with open(os.path.join("examples",name),"r") as f:
+        examples.append(f.readlines())
+  commands=[]
+  for arena in range(0,LASTARENA+1):
+    arenafolder=os.path.join(folder,"arena"+str(arena))
+    os.makedirs(arenafolder,exist_ok=True)
+    files=[]
+    for i in range(0,len(examples)):
+      files.append(os.path.join(arenafolder,"e"+str(i+1)+".red"))
+      with open(files[-1],"w") as f:
+        f.writelines(clean_warrior(examples[i],arena))
+    for i in range(0,TRAINING_WARRIORS):
+      files.append(os.path.join(arenafolder,"r"+str(i+1)+".red"))
+      with open(files[-1],"w") as f:
+        f.writelines([sanitize_line(random_instruction(arena),arena) for j in range(0,WARLEN_LIST[arena])])
+    pairingspath=os.path.join(folder,"pairings"+str(arena)+".txt")
+    with open(pairingspath,"w") as f:
+      for i in range(0,TRAINING_PAIRINGS):
+        file1,file2=random.sample(files,2)
+        f.write(file1+" "+file2+"\n")
+    commands.append(" ".join(["python","evolverstage.py","--batch","-r",str(BATTLEROUNDS_LIST[-1])]+ARENA_FLAGS[arena]+[pairingspath]))
+  return commands
+
+if len(sys.argv)>2 and sys.argv[1]=="--training":
+  for command in write_training(sys.argv[2]):
+    print(command)
+  quit()
+
+#python evolverstage.py --bench [optimized simulator] [training folder]
+#Given a second simulator, such as a profile-guided build, also time both of them on the training workload in the folder
+#(see --training, it's written there first if the folder doesn't have one yet), arena by arena, and report how much faster
+#it is than the usual one. Both play the same BENCH_BATTLES pairings, taking turns, with the usual timeouts and retries.
+BENCH_BATTLES=10
+
+def bench_simulators(arena,folder,optimized):
+  #milliseconds for the usual simulator and the optimized one, or None if a battle failed
+  with open(os.path.join(folder,"pairings"+str(arena)+".txt"),"r") as f:
+    pairings=[line.split() for line in f][0:BENCH_BATTLES]
+  times=[0.0,0.0]
+  for file1,file2 in pairings:
+    names=[os.path.splitext(os.path.basename(path))[0] for path in (file1,file2)]
+    for which,program in enumerate((None,optimized)):
+      start=time.perf_counter()
+      if run_files(arena,file1,file2,names[0],names[1],BATTLEROUNDS_LIST[-1],False,program=program) is None:
+        return None
+      times[which]=times[which]+(time.perf_counter()-start)*1000
+  return times
+
+if len(sys.argv)>1 and sys.argv[1]=="--bench":
+  print("arena  coresize  length  operation   structs(ms)  arrays(ms)")
+  for arena in range(0,LASTARENA+1):
+    for name,aos_time,soa_time in bench_layouts(arena):
+      print("{0:5d}  {1:8d}  {2:6d}  {3:9s}  {4:11.1f}  {5:10.1f}".format(arena,CORESIZE_LIST[arena],WARLEN_LIST[arena],name,aos_time,soa_time))
+  if len(sys.argv)==3:
+    print("To compare simulators, also give a folder for the training workload: --bench program folder")
+  elif len(sys.argv)>3:
+    if not os.path.exists(os.path.join(sys.argv[3],"pairings0.txt")):
+      print("Writing the training workload to "+sys.argv[3])
+      write_training(sys.argv[3])
+    print("arena  coresize  usual(ms)  optimized(ms)  gain")
+    for arena in range(0,LASTARENA+1):
+      try:
+        times=bench_simulators(arena,sys.argv[3],sys.argv[2])
+      except OSError:
+        quit(1) #run_files has said which program couldn't be run
+      if times is None:
+        print("{0:5d}  {1:8d}  battles failed".format(arena,CORESIZE_LIST[arena]))
+      else:
+        print("{0:5d}  {1:8d}  {2:9.0f}  {3:13.0f}  {4:4.0%}".format(arena,CORESIZE_LIST[arena],times[0],times[1],times[0]/times[1]-1))
+  quit()
+
+#python evolverstage.py --batch -r 100 -s 8000 -c 80000 pairings.txt
+#Instead of evolving, play a batch of battles. Each line of the file (or of standard input, if there's no file) names two
+#warrior files. Any nMars flags given are passed to every battle. One line comes out per pairing, in the same order:
+#the two files and their scores, or "failed". The battles themselves run BATTLE_THREADS at a time.
+def warrior_name(path):
+  #what nMars will call a warrior: its ;name (all of it, names can have spaces), or else its file name without the .red
+  with open(path,"r") as f:
+    for line in f:
+      if line.lower().startswith(";name") and line[5:].strip()!="":
+        return line[5:].strip()
+  return os.path.splitext(re.split(r'[\\/]',path)[-1])[0]
+
+if len(sys.argv)>1 and sys.argv[1]=="--batch":
+  flags=[]
+  source=sys.stdin
+  i=2
+  while i<len(sys.argv):
+    if sys.argv[i]=="-xp":
+      flags.append(sys.argv[i])
+      i=i+1
+    elif sys.argv[i].startswith("-"):
+      flags.extend(sys.argv[i:i+2])
+      i=i+2
+    else:
+      source=open(sys.argv[i],"r")
+      i=i+1
+  def batch_battle(file1,file2):
+    try:
+      name1=warrior_name(file1)
+      name2=warrior_name(file2)
+    except (OSError,UnicodeDecodeError):
+      return None #a missing or unreadable file only fails its own pairing
+    if name1==name2:
+      return None #nMars would call both the same, so there's no telling their scores apart
+    results=run_files(None,file1,file2,name1,name2,1,False,flags)
+    if results is None:
+      return None
+    return (results[name1],results[name2])
+  inflight=[]
+  def print_oldest():
+    file1,file2,job=inflight.pop(0)
+    score=job.result()
+    if score is None:
+      print(file1+" "+file2+" failed",flush=True)
+    else:
+      print(file1+" "+file2+" "+str(score[0])+" "+str(score[1]),flush=True)
+  for line in source:
+    pairing=line.split()
+    if len(pairing)<2:
+      continue
+    inflight.append((pairing[0],pairing[1],submit_job(PRIORITY_INTERACTIVE,batch_battle,pairing[0],pairing[1])))
+    if len(inflight)>=BATTLE_THREADS*4:
+      print_oldest()
+  while inflight:
+    print_oldest()
+  quit()
+
+#python evolverstage.py --minimize 3 mywarrior.red benchmarkfolder
+#Instead of evolving, shrink a warrior down to the instructions that actually earn its score against a folder of benchmark
+#warriors. Chunks of instructions are swapped for DAT.F $0,$0 (so nothing else moves), all the chunks of one size are tried
+#at once, and a change is kept if the score stays within MINIMIZE_TOLERANCE. Then smaller chunks, down to one instruction.
+MINIMIZE_TOLERANCE=0.02 #fraction of the original benchmark score it may lose
+if len(sys.argv)>4 and sys.argv[1]=="--minimize":
+  arena=int(sys.argv[2])
+  sourcepath=sys.argv[3]
+  benchmarks=[os.path.join(sys.argv[4],name) for name in sorted(os.listdir(sys.argv[4])) if name.endswith(".red")]
+  rounds=BATTLEROUNDS_LIST[-1]
+  emptyline='DAT.F $0,$0\n'
+  with open(sourcepath,"r") as f:
+    warlines=clean_warrior(f.readlines(),arena)
+  if not os.path.exists("minimize"):
+    os.mkdir("minimize")
+  candidate_counter=itertools.count(1)
+  def benchmark_scores(trials):
+    #Total score of each trial against the whole benchmark, or None if one of its battles failed. Every battle of every
+    #trial goes out as one batch.
+    names=[str(next(candidate_counter)) for trial in trials]
+    paths=["minimize\\"+name+".red" for name in names]
+    for path,trial in zip(paths,trials):
+      with open(path,"w") as f:
+        f.writelines(trial)
+    scores=battle_file_pairs(arena,[(path,name,bench,None) for path,name in zip(paths,names) for bench in benchmarks],rounds,PRIORITY_INTERACTIVE)
+    for path in paths:
+      os.remove(path)
+    totals=[]
+    for t in range(0,len(trials)):
+      mine=scores[t*len(benchmarks):(t+1)*len(benchmarks)]
+      totals.append(None if None in mine else sum(score[0] for score in mine))
+    return totals
+  baseline=benchmark_scores([warlines])[0]
+  if baseline is None:
+    print("Couldn't score "+sourcepath)
+    quit()
+  if baseline==0:
+    print(sourcepath+" scores nothing against the benchmark, so there's nothing to keep")
+    quit()
+  print("Score of "+sourcepath+" against "+str(len(benchmarks))+" benchmark warriors: "+str(baseline))
+  live=[i for i in range(len(warlines)) if warlines[i]!=emptyline]
+  chunk=max(1,len(live)//2)
+  while len(live)>0:
+    chunks=[live[i:i+chunk] for i in range(0,len(live),chunk)]
+    trials=[]
+    for c in chunks:
+      trial=list(warlines)
+      for i in c:
+        trial[i]=emptyline
+      trials.append(trial)
+    kept=False
+    for c,trial,score in zip(chunks,trials,benchmark_scores(trials)):
+      if kept==False and score is not None and score>=baseline*(1-MINIMIZE_TOLERANCE):
+        print("Removed "+str(len(c))+" instructions, score "+str(score))
+        warlines=trial
+        live=[i for i in live if i not in c]
+        kept=True
+    if kept==False:
+      if chunk==1:
+        break
+      chunk=max(1,chunk//2)
+  while len(warlines)>1 and warlines[-1]==emptyline:
+    warlines.pop() #trailing DATs are the same as empty core
+  outpath=sourcepath[:-4]+"-min.red" if sourcepath.endswith(".red") else sourcepath+"-min.red"
+  with open(outpath,"w") as f:
+    f.writelines(warlines)
+  print(str(len(live))+" live instructions written to "+outpath)
+  quit()
+
 if ALREADYSEEDED==False: 
   print("Seeding")
+  for path in (CHECKPOINT_SNAPSHOT,CHECKPOINT_LOG,CHECKPOINT_WAL):
+    if os.path.exists(path):
+      os.remove(path) #an older run's, it would be mixed in with this one on resume
   os.mkdir("archive")
   for arena in range (0,LASTARENA+1):
     os.mkdir("arena"+str(arena))
@@ -120,7 +1245,86 @@ if ALREADYSEEDED==False:
         f.write(random.choice(INSTR_SET)+"."+random.choice(INSTR_MODIF)+" "+random.choice(INSTR_MODES)+str(corenorm(coremod(num1,SANITIZE_LIST[arena]),CORESIZE_LIST[arena]))+","+random.choice(INSTR_MODES)+str(corenorm(coremod(num2,SANITIZE_LIST[arena]),CORESIZE_LIST[arena]))+"\n")
       f.close()
 
-starttime=time.time() #time in seconds
+#Load every arena into memory up front. Almost every file is one the evolver wrote itself, in exactly the form sanitize_line
+#gives back, so a file whose whole text matches that form (and has the right length) is taken as it is. Only the others go
+#through clean_warrior: files written by other evolvers (extra spaces, comments, a ;name line nMars would call them by) are
+#cleaned up and saved back. A file that can't be made sense of (or is missing) is reported, kept beside the slot as .bad,
+#and the slot gets a fresh random warrior, so breeding never runs into it later.
+OWN_FORMAT_RE=re.compile(r'(?:[A-Z]{3}\.(?:AB|BA|A|B|F|X|I) [#$*@{<}>]-?\d+,[#$*@{<}>]-?\d+\n)*')
+
+def import_slot(arena,slot):
+  #(lines, whether they need saving back), or (None, what went wrong)
+  path=warrior_path(arena,slot)
+  try:
+    with open(path,"r") as f:
+      text=f.read()
+    if OWN_FORMAT_RE.fullmatch(text):
+      lines=text.splitlines(True)
+      if len(lines)==WARLEN_LIST[arena] or (VARIABLE_LENGTH==True and 0<len(lines)<WARLEN_LIST[arena]):
+        return (lines,False)
+    raw=text.splitlines(True)
+    lines=clean_warrior(raw,arena)
+  except (OSError,IndexError,ValueError) as e:
+    return (None,path+": "+str(e))
+  return (lines,lines!=raw)
+
+importstart=time.time()
+loaded=0
+rewritten=0
+malformed=0
+for arena in range(0,LASTARENA+1):
+  for slot in range(1,NUMWARRIORS+1):
+    lines,extra=import_slot(arena,slot)
+    if lines is None:
+      print("Malformed warrior, replaced with a random one: "+extra)
+      path=warrior_path(arena,slot)
+      if os.path.exists(path):
+        os.replace(path,path+".bad")
+      write_warrior(arena,slot,[sanitize_line(random_instruction(arena),arena) for j in range(0,WARLEN_LIST[arena])])
+      malformed=malformed+1
+    elif extra==True:
+      write_warrior(arena,slot,lines)
+      rewritten=rewritten+1
+    else:
+      warrior_cache[(arena,slot)]=intern_warrior(lines,True)
+    loaded=loaded+1
+print("Loaded "+str(loaded)+" warriors in {0:.2f} seconds".format(time.time()-importstart)+" ("+str(rewritten)+" cleaned up, "+str(malformed)+" malformed and replaced)")
+
+resumed_hours=0
+if (CHECKPOINT_INTERVAL>0 or WAL_COMMIT_INTERVAL>0) and ALREADYSEEDED==True:
+  population,meta=restore_checkpoint()
+  #the files should already match, unless the run stopped between changing a warrior and checkpointing it
+  for (arena,slot),lines in population.items():
+    if warrior_cache.get((arena,slot))!=tuple(lines):
+      write_warrior(arena,slot,lines)
+  if meta is not None:
+    resumed_hours=meta["elapsed"]
+    metrics.update(meta["metrics"])
+    print("Resuming from checkpoint "+str(meta["seq"])+" after {0:.2f} hours".format(resumed_hours))
+#Slots written since the last checkpoint (cleaned up or replaced at import, recovered from the WAL) stay dirty, so the next
+#checkpoint has them before it empties the WAL.
+
+#python evolverstage.py --rank 3
+#Instead of evolving, play a round robin in that arena and list the warriors from best to worst.
+if len(sys.argv)>2 and sys.argv[1]=="--rank":
+  arena=int(sys.argv[2])
+  slots=list(range(1,NUMWARRIORS+1))
+  pairs=[(slots[i],slots[j]) for i in range(len(slots)) for j in range(i+1,len(slots))]
+  print("Round robin of "+str(len(pairs))+" battles in arena "+str(arena))
+  totals=dict((slot,0) for slot in slots)
+  for (a,b),score in zip(pairs,battle_pairs(arena,pairs,BATTLEROUNDS_LIST[-1],PRIORITY_INTERACTIVE)):
+    if score is None:
+      continue
+    totals[a]=totals[a]+score[0]
+    totals[b]=totals[b]+score[1]
+  for slot in sorted(slots,key=lambda slot:-totals[slot]):
+    print(warrior_path(arena,slot)+" "+str(totals[slot]))
+  quit()
+
+starttime=time.time()-resumed_hours*60*60 #time in seconds
+lastcheckpoint=time.time()
+lastexport=time.time()
+failedinarow=0
 era=-1
 
 while(True):
@@ -133,6 +1337,12 @@ while(True):
     era=1
   if runtime_in_hours>CLOCK_TIME*(2/3):
     era=2
+  if CHECKPOINT_INTERVAL>0 and (curtime-lastcheckpoint>CHECKPOINT_INTERVAL or runtime_in_hours>CLOCK_TIME):
+    checkpoint(runtime_in_hours)
+    lastcheckpoint=curtime
+  if EXPORT_PATH!="" and (curtime-lastexport>EXPORT_INTERVAL or runtime_in_hours>CLOCK_TIME):
+    export_columns()
+    lastexport=curtime
   if runtime_in_hours>CLOCK_TIME:
     quit()
   if FINAL_ERA_ONLY==True:
@@ -149,6 +1359,8 @@ while(True):
     bag.extend([6]* MAGIC_NUMBER_LIST[era])
     
   print ("{0:.2f}".format(CLOCK_TIME-runtime_in_hours) +" hours remaining ({0:.2f}%".format(runtime_in_hours/CLOCK_TIME*100)+" complete) Era: "+str(era+1))
+  if metrics:
+    print(", ".join(name+": "+str(metrics[name]) for name in sorted(metrics)))
   
   #in a random arena
   arena=random.randint(0, LASTARENA)
@@ -158,32 +1370,21 @@ while(True):
     cont2=random.randint(1, NUMWARRIORS)
     if cont1!=cont2:
       break;
-  '''
-nMars reference
-Rules:
-  -r #      Rounds to play [1]
-  -s #      Size of core [8000]
-  -c #      Cycle until tie [80000]
-  -p #      Max. processes [8000]
-  -l #      Max. warrior length [100]
-  -d #      Min. warriors distance
-  -S #      Size of P-space [500]
-  -f #      Fixed position series
-  -xp       Disable P-space
-  '''
-  cmdline="nmars.exe arena"+str(arena)+"\\"+str(cont1)+".red arena"+str(arena)+"\\"+str(cont2)+".red -s "+str(CORESIZE_LIST[arena])+" -c "+str(CYCLES_LIST[arena])+" -p "+str(PROCESSES_LIST[arena])+" -l "+str(WARLEN_LIST[arena])+" -d "+str(WARDISTANCE_LIST[arena])+" -r "+str(BATTLEROUNDS_LIST[era])+" > output.txt"
-  print(cmdline)
-  os.system(cmdline)
-  scores=[]
-  warriors=[]
-  #note nMars will sort by score regardless of the order in the command-line, so match up score with warrior
-  with open('output.txt', 'r') as f:
-    for line in f:
-      if "scores" in line:
-        print(line.strip())
-        splittedline=line.split()
-        scores.append( int(splittedline [4]))
-        warriors.append( int(splittedline [0]))
+  try:
+    results=submit_job(PRIORITY_BACKGROUND,run_battle,arena,cont1,cont2,BATTLEROUNDS_LIST[era]).result()
+  except OSError:
+    quit(1)
+  if results is None:
+    print("battle failed, skipping it")
+    failedinarow=failedinarow+1
+    if failedinarow>=FAILED_BATTLES_LIMIT:
+      print(str(failedinarow)+" battles in a row failed, stopping. Check SIMULATOR and the arena settings.")
+      quit(1)
+    continue
+  failedinarow=0
+  warriors=[cont1,cont2]
+  scores=[results[cont1],results[cont2]]
+  record_result(arena,era,cont1,cont2,scores[0],scores[1])
 
   if scores[1]==scores[0]:
     print("draw") #in case of a draw, destroy one at random. we want attacking.
@@ -201,68 +1402,80 @@ Rules:
     loser=warriors[1]
      
 
-  if random.randint(1,ARCHIVE_LIST[era])==1:
+  if ARCHIVE_GRID==True:
+    #Every winner is a candidate for its cell in the grid, and an empty cell is simply taken. Now and then (ARCHIVE_LIST)
+    #a winner challenges the warrior already in its cell instead, and takes over if it beats it. So a cell's warrior is
+    #never safe for good, however lucky its first win was.
+    cell=(arena,)+behaviour_cell(read_warrior(arena,winner),arena)
+    takeover=False
+    if not os.path.exists(grid_path(cell)):
+      takeover=True
+    elif random.randint(1,ARCHIVE_LIST[era])==1:
+      print("challenging archive cell "+str(cell))
+      try:
+        challenge=submit_job(PRIORITY_BACKGROUND,run_files,arena,warrior_path(arena,winner),grid_path(cell),str(winner),grid_name(cell),BATTLEROUNDS_LIST[era],False).result()
+      except OSError:
+        quit(1)
+      takeover=challenge is not None and challenge[str(winner)]>challenge[grid_name(cell)]
+    if takeover:
+      print("storing in archive cell "+str(cell))
+      with open(grid_path(cell),"w") as fd:
+        fd.write("".join(read_warrior(arena,winner)))
+  elif random.randint(1,ARCHIVE_LIST[era])==1:
     #archive winner
     print("storing in archive")
-    fw=open("arena"+str(arena)+"\\"+str(winner)+".red", "r")
-    winnerraw=fw.read() #don't need to process it, just store as is
-    fw.close()
+    winnerraw="".join(read_warrior(arena,winner)) #don't need to process it, just store as is
     fd=open("archive\\"+str(random.randint(1,9999))+".red", "w")
     fd.write(winnerraw)
     fd.close()
 
-  if random.randint(1,UNARCHIVE_LIST[era])==1:
+  if random.randint(1,UNARCHIVE_LIST[era])==1 and len(os.listdir("archive\\"))>0:
     print("unarchiving")
     #replace loser with something from archive
     fs=open("archive\\"+random.choice(os.listdir("archive\\")))
     sourcelines=fs.readlines()
     fs.close()
     #this is more involved. the archive is going to contain warriors from different arenas. which isn't necessarily bad to get some crossover. A nano warrior would be workable,if
-    #inefficient in a normal core. These are the tasks:
-    #1. Truncate any too long
-    #2. Pad any too short with DATs
-    #3. Sanitize values
-    #4. Try to be tolerant of working with other evolvers that may not space things exactly the same.
-    fl=open("arena"+str(arena)+"\\"+str(loser)+".red", "w") #unarchived warrior destroys loser
-    countoflines=0
-    for line in sourcelines:
-      countoflines=countoflines+1
-      if countoflines>WARLEN_LIST[arena]:
-        break
-      line=line.replace('  ',' ').replace('START','').replace(', ',',').strip()
-      splitline=re.split('[ \.,\n]', line)
-      line=splitline[0]+"."+splitline[1]+" "+splitline[2][0:1]+str(corenorm(coremod(int(splitline[2][1:]),SANITIZE_LIST[arena]),CORESIZE_LIST[arena]))+","+splitline[3][0:1]+str(corenorm(coremod(int(splitline[3][1:]),SANITIZE_LIST[arena]),CORESIZE_LIST[arena]))+"\n"
-      fl.write(line)
-    while countoflines<WARLEN_LIST[arena]:
-      countoflines=countoflines+1
-      fl.write('DAT.F $0,$0\n')
-    fl.close()
+    #inefficient in a normal core. (see clean_warrior)
+    try:
+      newlines=clean_warrior(sourcelines,arena)
+    except (IndexError,ValueError):
+      print("couldn't make sense of that one, skipping it")
+      continue
+    write_warrior(arena,loser,newlines) #unarchived warrior destroys loser
+    record_lineage(arena,era,loser,0,0,1)
     continue #out of while (loser replaced by archive, no point breeding)
     
   #the loser is destroyed and the winner can breed with any warrior in the arena  
-  fw=open("arena"+str(arena)+"\\"+str(winner)+".red", "r")
-  winlines=fw.readlines()
-  fw.close()
+  winlines=list(read_warrior(arena,winner)) #a copy, transposition shuffles it in place
   randomwarrior=str(random.randint(1, NUMWARRIORS))
   print("winner will breed with "+randomwarrior)
-  fr=open("arena"+str(arena)+"\\"+randomwarrior+".red", "r") #winner mates with random warrior
-  ranlines=fr.readlines()
-  fr.close()
-  fl=open("arena"+str(arena)+"\\"+str(loser)+".red", "w") #winner destroys loser
+  ranlines=list(read_warrior(arena,randomwarrior)) #winner mates with random warrior
+  newlines=[]
+
+  if random.randint(1, LINKEDRATE_LIST[era])==1: #move linked pointers in the winner together
+    classes=pointer_classes(winlines,arena)
+    if classes:
+      if random.randint(1,4)==1:
+        offset=random.randint(-WARLEN_LIST[arena],WARLEN_LIST[arena])
+      else:
+        offset=random.choice([-1,1])
+      members=random.choice(classes)
+      print("Linked pointer mutation ("+str(len(members))+" fields)")
+      shift_pointers(winlines,members,offset)
     
   if random.randint(1, TRANSPOSITIONRATE_LIST[era])==1: #shuffle a warrior
     print("Transposition")
     for i in range(1, random.randint(1, int((WARLEN_LIST[arena]+1)/2))):
-      fromline=random.randint(0,WARLEN_LIST[arena]-1)
-      toline=random.randint(0,WARLEN_LIST[arena]-1)
       if random.randint(1,2)==1: #either shuffle the winner with itself or shuffle loser with itself
-        templine=winlines[toline]
-        winlines[toline]=winlines[fromline]
-        winlines[fromline]=templine
+        shuffling=winlines
       else:
-        templine=ranlines[toline]
-        ranlines[toline]=ranlines[fromline]
-        ranlines[fromline]=templine
+        shuffling=ranlines
+      fromline=random.randint(0,len(shuffling)-1)
+      toline=random.randint(0,len(shuffling)-1)
+      templine=shuffling[toline]
+      shuffling[toline]=shuffling[fromline]
+      shuffling[fromline]=templine
   if PREFER_WINNER_LIST[era]==True:  
     pickingfrom=1 #if start picking from the winning warrior, more chance of winning genes passed on.
   else:
@@ -273,7 +1486,12 @@ Rules:
   else:
     magic_number=random.randint(-WARLEN_LIST[arena],WARLEN_LIST[arena])
 
-  for i in range(0, WARLEN_LIST[arena]):
+  #the offspring is as long as the parent it starts out copying from. Past the end of one parent, lines come from the other.
+  if pickingfrom==1:
+    newlength=min(len(winlines),WARLEN_LIST[arena])
+  else:
+    newlength=min(len(ranlines),WARLEN_LIST[arena])
+  for i in range(0, newlength):
     #first, pick an instruction from either parent, even if it will get overwritten by a nabbed or random instruction
     if random.randint(1,CROSSOVERRATE_LIST[era])==1:
       if pickingfrom==1:
@@ -281,7 +1499,7 @@ Rules:
       else:
         pickingfrom=1
 
-    if pickingfrom==1:
+    if (pickingfrom==1 and i<len(winlines)) or i>=len(ranlines):
       templine=(winlines[i])
     else:
       templine=(ranlines[i])
@@ -289,24 +1507,16 @@ Rules:
     marble=random.choice(bag)  
     if marble==1: #a major mutation, completely random
       print("Major mutation")
-      if random.randint(1,4)==1:
-        num1=random.randint(-CORESIZE_LIST[arena],CORESIZE_LIST[arena])
-      else:
-        num1=random.randint(-WARLEN_LIST[arena],WARLEN_LIST[arena])
-      if random.randint(1,4)==1:
-        num2=random.randint(-CORESIZE_LIST[arena],CORESIZE_LIST[arena])
-      else:
-        num2=random.randint(-WARLEN_LIST[arena],WARLEN_LIST[arena])
-      templine=random.choice(INSTR_SET)+"."+random.choice(INSTR_MODIF)+" "+random.choice(INSTR_MODES)+str(num1)+","+random.choice(INSTR_MODES)+str(num2)+"\n"
+      templine=random_instruction(arena)
     elif (marble==2) and (LASTARENA!=0): #nab instruction fron another arena. Doesn't make sense if not multiple arenas
       donor_arena=random.randint(0, LASTARENA)
       while (donor_arena==arena):
         donor_arena=random.randint(0, LASTARENA)
       print("Nab instruction from arena " + str(donor_arena))
-      templine=random.choice(list(open("arena"+str(donor_arena)+"\\"+str(random.randint(1, NUMWARRIORS))+".red")))
+      templine=random.choice(read_warrior(donor_arena,random.randint(1, NUMWARRIORS)))
     elif marble==3: #a minor mutation modifies one aspect of instruction
       print("Minor mutation")
-      splitline=re.split('[ \.,\n]', templine)
+      splitline=SPLIT_RE.split(templine)
       r=random.randint(1,6)
       if r==1:
         splitline[0]=random.choice(INSTR_SET)
@@ -333,7 +1543,7 @@ Rules:
       templine=splitline[0]+"."+splitline[1]+" "+splitline[2]+","+splitline[3]+"\n"
     elif marble==4: #a micro mutation modifies one number by +1 or -1
       print ("Micro mutation")
-      splitline=re.split('[ \.,\n]', templine)
+      splitline=SPLIT_RE.split(templine)
       r=random.randint(1,2)
       if r==1:
         num1=int(splitline[2][1:])
@@ -352,10 +1562,10 @@ Rules:
       templine=splitline[0]+"."+splitline[1]+" "+splitline[2]+","+splitline[3]+"\n"
     elif marble==5 and LIBRARY_PATH!="": #choose instruction from instruction library
       print("Instruction library")
-      templine=random.choice(list(open(LIBRARY_PATH)))
+      templine=random.choice(library_lines)
     elif marble==6: #magic number mutation
       print ("Magic number mutation")
-      splitline=re.split('[ \.,\n]', templine)
+      splitline=SPLIT_RE.split(templine)
       r=random.randint(1,2)
       if r==1:
         splitline[2]=splitline[2][0:1]+str(magic_number)
@@ -363,12 +1573,20 @@ Rules:
         splitline[3]=splitline[3][0:1]+str(magic_number)
       templine=splitline[0]+"."+splitline[1]+" "+splitline[2]+","+splitline[3]+"\n"
       
-    splitline=re.split('[ \.,\n]', templine)
-    templine=splitline[0]+"."+splitline[1]+" "+splitline[2][0:1]+str(corenorm(coremod(int(splitline[2][1:]),SANITIZE_LIST[arena]),CORESIZE_LIST[arena]))+","+splitline[3][0:1]+str(corenorm(coremod(int(splitline[3][1:]),SANITIZE_LIST[arena]),CORESIZE_LIST[arena]))+"\n"
-    fl.write(templine)      
+    templine=sanitize_line(templine,arena)
+    newlines.append(templine)
     magic_number=magic_number-1  
 
-  fl.close()
+  if VARIABLE_LENGTH==True:
+    if len(newlines)<WARLEN_LIST[arena] and random.randint(1, INSERTIONRATE_LIST[era])==1:
+      print("Insertion")
+      insert_instruction(newlines,random.randint(0,len(newlines)),random_instruction(arena))
+    if len(newlines)>1 and random.randint(1, DELETIONRATE_LIST[era])==1:
+      print("Deletion")
+      delete_instruction(newlines,random.randint(0,len(newlines)-1))
+    newlines=[sanitize_line(line,arena) for line in newlines]
+  write_warrior(arena,loser,newlines) #winner destroys loser
+  record_lineage(arena,era,loser,winner,int(randomwarrior),0)
 #  time.sleep(3) #uncomment this for simple proportion of sleep if you're using computer for something else
 
 #experimental. detect if computer being used and yield to other processes.